@@ -0,0 +1,70 @@
+#ifndef analyze_h
+#define analyze_h
+
+#include "bmp.h"
+
+/// Tiles are squares with this side unless specified otherwise
+#define ANALYZE_DEFAULT_TILE_SIZE 64
+
+/**
+ LSB embedding statistics of one color channel
+
+ `chiSquare` - chi-square statistic over the pairs of values which differ only in the lowest bit
+ `probability` - probability of embedding by the chi-square attack, close to 1 if all LSBs carry a message
+ `rsEstimate` - estimated fraction of the LSBs carrying a message, by the RS analysis
+ */
+typedef struct {
+    double chiSquare;
+    double probability;
+    double rsEstimate;
+} LsbStats;
+
+
+/// Statistics of one tile of the image, channels are indexed like in the file: 0 - B, 1 - G, 2 - R
+typedef struct {
+    Rect rect;
+    LsbStats channels[3];
+} TileAnalysis;
+
+
+/**
+ Result of the image analysis
+
+ `tiles` are stored row by row starting from the top left corner of the image,
+ tiles in the last row and column may be smaller than `tileSize`.
+ `image` holds statistics of the whole image.
+
+ Should only be initialized via `analyzeBmp` function
+ After no longer needed, should be destroyed by `destroyAnalysis` function
+ */
+typedef struct {
+    uint32_t width, height;
+    int tileSize;
+    size_t tilesCount;
+    TileAnalysis *tiles;
+    LsbStats image[3];
+} Analysis;
+
+
+/**
+ Computes chi-square and RS statistics of the bmp file for the whole image and for each tile
+
+ The file is read once by bands of rows, the work is split between `threads` threads by rows of tiles,
+ 0 to use one per online CPU.
+
+ In case of an error `result` argument will still be uninitialized
+
+ - Parameter result: pointer to an uninitialized `Analysis` struct
+ - Parameter filename: name of the file to analyze
+ - Parameter tileSize: side of a tile in pixels
+ - Parameter threads: number of threads to use
+
+ - Returns: 0 on success, error code on failure
+ */
+int analyzeBmp(Analysis *result, const char *filename, int tileSize, int threads);
+
+
+/// Frees the resources of the `Analysis` struct
+void destroyAnalysis(Analysis *analysis);
+
+#endif /* analyze_h */
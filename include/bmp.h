@@ -2,6 +2,7 @@
 #define bmp_h
 
 #include <stdint.h>
+#include <stdio.h>
 
 /**
  Convinience struct to hold properties of a rectangle
@@ -109,4 +110,49 @@ int saveBmp(const Image *image, const char *filename);
  */
 void destoryImage(Image *image);
 
+/**
+ Bmp file opened for reading pixels by bands of rows, without loading the whole image into memory
+ 
+ Rows are read in the file order, from the bottom of the picture to the top, each row takes `stride` bytes
+ including the padding. Each pixel is 3 bytes wide.
+ 
+ Should only be initialized via `openBmp` function
+ After no longer needed, should be closed by `closeBmp` function
+ */
+typedef struct {
+    FILE *file;
+    uint32_t width, height;
+    uint32_t pixelsPosition, stride;
+} BmpReader;
+
+
+/**
+ Opens given bmp file and reads its header
+ 
+ In case of an error `reader` argument will still be uninitialized, you should not pass it to the `closeBmp` function
+ 
+ - Parameter reader: pointer to an uninitialized `BmpReader` struct
+ - Parameter filename: name of the file to read from
+ 
+ - Returns: 0 on success, error code on failure
+ */
+int openBmp(BmpReader *reader, const char *filename);
+
+
+/**
+ Reads a band of rows with the padding
+ 
+ - Parameter reader: pointer to a `BmpReader` struct
+ - Parameter firstRow: index of the first row to read in the file order, 0 is the bottom row of the picture
+ - Parameter count: number of rows to read, `firstRow + count <= height`
+ - Parameter buffer: buffer of at least `count * stride` bytes
+ 
+ - Returns: 0 on success, error code on failure
+ */
+int readBmpRows(BmpReader *reader, uint32_t firstRow, uint32_t count, unsigned char *buffer);
+
+
+/// Closes the file opened by `openBmp`
+void closeBmp(BmpReader *reader);
+
 #endif /* bmp_h */
@@ -0,0 +1,61 @@
+#ifndef compare_h
+#define compare_h
+
+#include "bmp.h"
+
+/**
+ Differences between two images of the same size
+
+ Per channel arrays are indexed the same way as components in the file: 0 - B, 1 - G, 2 - R
+
+ `changedBytes` - number of components which differ
+ `changedLsb` - number of components with different lowest bits
+ `lsbOnly` - number of components which differ only in the lowest bit
+ `squaredError` - sum of squared differences of components
+ `absoluteError` - sum of absolute differences of all components
+ `box` - bounding box of the changed pixels, `w` and `h` are 0 if images are equal
+ */
+typedef struct {
+    uint32_t width, height;
+    uint64_t changedBytes[3];
+    uint64_t changedLsb[3];
+    uint64_t lsbOnly[3];
+    uint64_t squaredError[3];
+    uint64_t absoluteError;
+    Rect box;
+} Comparison;
+
+
+/**
+ Compares two bmp files
+
+ Files are read by bands of rows, so memory usage doesn't depend on the image size.
+ The work is split between `threads` threads, 0 to use one per online CPU.
+
+ - Parameter result: pointer to a `Comparison` struct to fill
+ - Parameter first: name of the first file
+ - Parameter second: name of the second file
+ - Parameter threads: number of threads to use
+
+ - Returns: 0 on success, error code on failure, `EINVAL` if images have different sizes
+ */
+int compareBmp(Comparison *result, const char *first, const char *second, int threads);
+
+
+/// Row comparison kernels, `COMPARE_KERNEL_AUTO` picks the fastest one supported by the CPU
+typedef enum { COMPARE_KERNEL_AUTO, COMPARE_KERNEL_SCALAR, COMPARE_KERNEL_AVX2 } CompareKernel;
+
+
+/**
+ Forces the kernel used by the following `compareBmp` calls, so that tests can check each of them
+
+ Not thread safe, should not be called while a comparison is running
+
+ - Parameter kernel: kernel to use
+
+ - Returns: 0 on success, `ENOTSUP` if the kernel isn't supported by the CPU or the build,
+   `EINVAL` for an unknown kernel
+ */
+int compareSetKernel(CompareKernel kernel);
+
+#endif /* compare_h */
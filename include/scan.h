@@ -0,0 +1,36 @@
+#ifndef scan_h
+#define scan_h
+
+#include "stego.h"
+
+/**
+ Options of the directory scan
+
+ `stopPrefix` - stop the scan after a message starting with this prefix is found, `NULL` to disable
+ `stopOnValid` - stop the scan after a message made only of the alphabet characters is found
+ `threads` - number of worker threads, 0 to use one per online CPU
+ */
+typedef struct {
+    const char *stopPrefix;
+    int stopOnValid;
+    int threads;
+} ScanOptions;
+
+
+/**
+ Extracts message with the same key from every `.bmp` file in the directory tree
+
+ Files are processed in parallel, each worker reads only the bytes referenced by the key.
+ Results are printed to `stdout` as soon as they are ready, one `path<TAB>message` line per file,
+ characters outside of the alphabet are printed as `?`.
+ Files which can't be read are reported to `stderr` and skipped.
+
+ - Parameter directory: root of the directory tree to scan
+ - Parameter key: pointer to a key, loaded by `loadKey`
+ - Parameter options: pointer to a `ScanOptions` struct
+
+ - Returns: 0 on success, error code if the directory tree couldn't be read
+ */
+int scanDirectory(const char *directory, const Key *key, const ScanOptions *options);
+
+#endif /* scan_h */
@@ -13,4 +13,46 @@ int encode(Image *image, const char *keyFile, const char *messageFile);
 /// decodes message from image and writes it to the file
 int decode(const Image *image, const char *keyFile, const char *filename);
 
+
+/// One line of the key file: pixel coordinates and a color component
+/// `channel` is the byte offset of the component inside a `Pixel`: 0 - B, 1 - G, 2 - R
+typedef struct {
+    uint32_t x, y;
+    uint8_t channel;
+} KeyBit;
+
+
+/**
+ Parsed key file, to reuse one key for many images without reading it again
+
+ Only whole 5-bit groups are kept, so `length` is always divisible by 5
+ and never exceeds `5 * STEGO_MESSAGE_MAX_LENGTH`
+
+ Should only be initialized via `loadKey` function
+ After no longer needed, should be destroyed by `destroyKey` function
+ */
+typedef struct {
+    size_t length;
+    KeyBit *bits;
+} Key;
+
+
+/**
+ Reads and parses the key file
+
+ In case of an error `key` is left uninitialized
+
+ - Parameter key: pointer to an uninitialized `Key` struct
+ - Parameter keyFile: name of the key file
+
+ - Returns: 0 on success, error code on failure
+ */
+int loadKey(Key *key, const char *keyFile);
+
+/// Frees the resources of the `Key` struct
+void destroyKey(Key *key);
+
+/// Converts 5-bit code into a message character, returns 0 if the code isn't in the alphabet
+char decodeSymbol(uint8_t code);
+
 #endif /* stego_h */
@@ -0,0 +1,357 @@
+#include "analyze.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/// Approximate size of a band of rows read from the file at once
+#define ANALYZE_BAND_SIZE (1 << 20)
+/// Number of pixels in a group of the RS analysis
+#define ANALYZE_GROUP_SIZE 4
+/// Pairs of values with less occurrences are skipped by the chi-square attack
+#define ANALYZE_MIN_PAIR_COUNT 10
+
+/**
+ Raw counts of one channel, from which `LsbStats` are computed
+
+ `regular` and `singular` groups of the RS analysis:
+ [0] - flipping with the mask M, [1] - with the mask -M,
+ [2] and [3] - the same on the image with all LSBs flipped
+ */
+typedef struct {
+    uint64_t histogram[256];
+    uint64_t regular[4], singular[4];
+} Counts;
+
+/// Range of rows of tiles processed by one thread
+typedef struct {
+    const char *filename;
+    Analysis *result;
+    uint32_t begin, end;
+    Counts totals[3];
+    int error;
+} Task;
+
+
+/**
+ Logarithm of Γ(a) for positive `a` which is a multiple of ½, by Γ(a + 1) = aΓ(a) from Γ(1) = 1 or Γ(½) = √π
+
+ Used instead of `lgamma`, which writes the global `signgam` from the worker threads,
+ while `lgamma_r` isn't declared everywhere without `_REENTRANT`
+ */
+static double logGammaHalf(double a) {
+    // ln √π
+    double result = fmod(a, 1) == 0 ? 0 : 0.5723649429247001;
+    for (double n = a - 1; n > 0; n -= 1)
+        result += log(n);
+    return result;
+}
+
+
+/// Upper regularized incomplete gamma function Q(a, x), complement of the chi-square distribution function
+/// `a` is half the degrees of freedom, so it is a multiple of ½
+static double gammaQ(double a, double x) {
+    if (x <= 0) return 1;
+    double logPrefix = a * log(x) - x - logGammaHalf(a);
+
+    if (x < a + 1) {
+        // series for P(a, x)
+        double term = 1 / a, sum = term;
+        for (int n = 1; n < 1000 && fabs(term) > fabs(sum) * 1e-15; ++n) {
+            term *= x / (a + n);
+            sum += term;
+        }
+        return 1 - sum * exp(logPrefix);
+    }
+
+    // continued fraction for Q(a, x) by the modified Lentz's method
+    const double tiny = 1e-300;
+    double b = x + 1 - a, c = 1 / tiny, d = 1 / b, h = d;
+    for (int n = 1; n < 1000; ++n) {
+        double an = -n * (n - a);
+        b += 2;
+        d = an * d + b;
+        if (fabs(d) < tiny) d = tiny;
+        c = b + an / c;
+        if (fabs(c) < tiny) c = tiny;
+        d = 1 / d;
+        double delta = d * c;
+        h *= delta;
+        if (fabs(delta - 1) < 1e-15) break;
+    }
+    return exp(logPrefix) * h;
+}
+
+
+/// Chi-square attack: with LSB embedding values `2k` and `2k + 1` tend to occur equally often
+static void chiSquare(const Counts *counts, LsbStats *stats) {
+    double chi = 0;
+    int pairs = 0;
+
+    for (int k = 0; k < 128; ++k) {
+        uint64_t sum = counts->histogram[2 * k] + counts->histogram[2 * k + 1];
+        if (sum < ANALYZE_MIN_PAIR_COUNT) continue;
+
+        double expected = sum / 2.0;
+        double deviation = counts->histogram[2 * k] - expected;
+        chi += deviation * deviation / expected;
+        ++pairs;
+    }
+
+    stats->chiSquare = chi;
+    stats->probability = pairs > 1 ? gammaQ((pairs - 1) / 2.0, chi / 2) : 0;
+}
+
+
+/// RS analysis by J. Fridrich, M. Goljan and R. Du, estimates the message length from the regular and singular groups
+static void rsEstimate(const Counts *counts, LsbStats *stats) {
+    double d0 = (double)counts->regular[0] - counts->singular[0];
+    double dn0 = (double)counts->regular[1] - counts->singular[1];
+    double d1 = (double)counts->regular[2] - counts->singular[2];
+    double dn1 = (double)counts->regular[3] - counts->singular[3];
+
+    // 2(d1 + d0)x² + (d-0 - d-1 - d1 - 3d0)x + d0 - d-0 = 0
+    double a = 2 * (d1 + d0);
+    double b = dn0 - dn1 - d1 - 3 * d0;
+    double c = d0 - dn0;
+    double x = 0;
+
+    if (fabs(a) > 1e-9) {
+        double discriminant = b * b - 4 * a * c;
+        double root = sqrt(discriminant > 0 ? discriminant : 0);
+        double x1 = (-b + root) / (2 * a);
+        double x2 = (-b - root) / (2 * a);
+        // the root with the smaller absolute value is the right one
+        x = fabs(x1) < fabs(x2) ? x1 : x2;
+    }
+    else if (fabs(b) > 1e-9) x = -c / b;
+
+    double p = x / (x - 0.5);
+    stats->rsEstimate = p <= 0 || isnan(p) ? 0 : p > 1 ? 1 : p;
+}
+
+
+static void computeStats(const Counts *counts, LsbStats *stats) {
+    chiSquare(counts, stats);
+    rsEstimate(counts, stats);
+}
+
+
+/// Discrimination function of the RS analysis, smoothness of the group
+static int variation(const int values[ANALYZE_GROUP_SIZE]) {
+    int sum = 0;
+    for (int i = 1; i < ANALYZE_GROUP_SIZE; ++i)
+        sum += abs(values[i] - values[i - 1]);
+    return sum;
+}
+
+
+/// Classifies the group with masks M = [0 1 1 0] and -M, on the original and on the LSB flipped values
+static void classifyGroup(const int values[ANALYZE_GROUP_SIZE], Counts *counts) {
+    int flipped[ANALYZE_GROUP_SIZE];
+    for (int i = 0; i < ANALYZE_GROUP_SIZE; ++i)
+        flipped[i] = values[i] ^ 1;
+
+    const int *sources[2] = { values, flipped };
+
+    for (int s = 0; s < 2; ++s) {
+        const int *group = sources[s];
+        int base = variation(group);
+
+        // F1: 2k <-> 2k + 1
+        int positive[ANALYZE_GROUP_SIZE] = { group[0], group[1] ^ 1, group[2] ^ 1, group[3] };
+        // F-1: 2k - 1 <-> 2k
+        int negative[ANALYZE_GROUP_SIZE] = {
+            group[0], ((group[1] + 1) ^ 1) - 1, ((group[2] + 1) ^ 1) - 1, group[3]
+        };
+
+        int positiveVariation = variation(positive);
+        int negativeVariation = variation(negative);
+
+        counts->regular[2 * s] += positiveVariation > base;
+        counts->singular[2 * s] += positiveVariation < base;
+        counts->regular[2 * s + 1] += negativeVariation > base;
+        counts->singular[2 * s + 1] += negativeVariation < base;
+    }
+}
+
+
+/// Adds one row of pixels to the counts of the tiles in the row, `counts` holds 3 channels for each tile
+static void countRow(const unsigned char *row, uint32_t width, int tileSize, Counts *counts) {
+    for (uint32_t begin = 0; begin < width; begin += tileSize) {
+        uint32_t end = begin + tileSize < width ? begin + tileSize : width;
+        Counts *tile = counts + 3 * (begin / tileSize);
+
+        // plain scalar increments: interleaved sub-histograms measured slower, every tile would hold several copies
+        uint64_t *blue = tile[0].histogram, *green = tile[1].histogram, *red = tile[2].histogram;
+        for (uint32_t x = begin; x < end; ++x) {
+            const unsigned char *pixel = row + x * sizeof(Pixel);
+            ++blue[pixel[0]];
+            ++green[pixel[1]];
+            ++red[pixel[2]];
+        }
+
+        // groups don't cross the tile border, the remaining pixels are skipped
+        for (uint32_t x = begin; x + ANALYZE_GROUP_SIZE <= end; x += ANALYZE_GROUP_SIZE) {
+            for (int c = 0; c < 3; ++c) {
+                int values[ANALYZE_GROUP_SIZE];
+                for (int i = 0; i < ANALYZE_GROUP_SIZE; ++i)
+                    values[i] = row[(x + i) * sizeof(Pixel) + c];
+                classifyGroup(values, tile + c);
+            }
+        }
+    }
+}
+
+
+static void mergeCounts(Counts *to, const Counts *from) {
+    for (int i = 0; i < 256; ++i)
+        to->histogram[i] += from->histogram[i];
+    for (int i = 0; i < 4; ++i) {
+        to->regular[i] += from->regular[i];
+        to->singular[i] += from->singular[i];
+    }
+}
+
+
+static int analyzeRows(Task *task) {
+    Analysis *result = task->result;
+    uint32_t tileSize = result->tileSize;
+
+    BmpReader reader;
+    int error = openBmp(&reader, task->filename);
+    if (error != 0) return error;
+
+    uint32_t tilesX = (result->width + tileSize - 1) / tileSize;
+    uint32_t bandRows = ANALYZE_BAND_SIZE / reader.stride;
+    if (bandRows == 0) bandRows = 1;
+
+    Counts *counts = calloc(3 * tilesX, sizeof(Counts));
+    unsigned char *band = malloc((size_t)bandRows * reader.stride);
+    if (!counts || !band) error = errno;
+
+    // tiles are counted from the top, but rows are stored from the bottom
+    uint32_t top = task->begin * tileSize;
+    uint32_t bottom = task->end * tileSize < result->height ? task->end * tileSize : result->height;
+    uint32_t fileEnd = result->height - top;
+
+    for (uint32_t row = result->height - bottom; error == 0 && row < fileEnd; row += bandRows) {
+        uint32_t count = fileEnd - row < bandRows ? fileEnd - row : bandRows;
+        error = readBmpRows(&reader, row, count, band);
+        if (error != 0) break;
+
+        for (uint32_t r = 0; r < count; ++r) {
+            countRow(band + (size_t)r * reader.stride, result->width, tileSize, counts);
+
+            uint32_t y = result->height - 1 - (row + r);
+            if (y % tileSize != 0) continue;
+
+            // the top row of the tiles is reached, so they are complete
+            TileAnalysis *tiles = result->tiles + (size_t)(y / tileSize) * tilesX;
+            for (uint32_t tx = 0; tx < tilesX; ++tx)
+                for (int c = 0; c < 3; ++c) {
+                    computeStats(counts + 3 * tx + c, tiles[tx].channels + c);
+                    mergeCounts(task->totals + c, counts + 3 * tx + c);
+                }
+            memset(counts, 0, 3 * tilesX * sizeof(Counts));
+        }
+    }
+
+    free(counts);
+    free(band);
+    closeBmp(&reader);
+    return error;
+}
+
+
+static void *work(void *argument) {
+    Task *task = argument;
+    task->error = analyzeRows(task);
+    return NULL;
+}
+
+
+int analyzeBmp(Analysis *result, const char *filename, int tileSize, int threads) {
+    if (tileSize <= 0) return EINVAL;
+
+    BmpReader reader;
+    int error = openBmp(&reader, filename);
+    if (error != 0) return error;
+    uint32_t width = reader.width, height = reader.height;
+    closeBmp(&reader);
+
+    uint32_t tilesX = (width + tileSize - 1) / tileSize;
+    uint32_t tilesY = (height + tileSize - 1) / tileSize;
+
+    result->width = width;
+    result->height = height;
+    result->tileSize = tileSize;
+    result->tilesCount = (size_t)tilesX * tilesY;
+    result->tiles = calloc(result->tilesCount, sizeof(TileAnalysis));
+    if (!result->tiles) return errno;
+
+    for (size_t i = 0; i < result->tilesCount; ++i) {
+        Rect *rect = &result->tiles[i].rect;
+        rect->x = i % tilesX * tileSize;
+        rect->y = i / tilesX * tileSize;
+        rect->w = width - rect->x < (uint32_t)tileSize ? width - rect->x : (uint32_t)tileSize;
+        rect->h = height - rect->y < (uint32_t)tileSize ? height - rect->y : (uint32_t)tileSize;
+    }
+
+    if (threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int)cpus : 1;
+    }
+    if ((uint32_t)threads > tilesY) threads = tilesY;
+
+    Task *tasks = calloc(threads, sizeof(Task));
+    pthread_t *ids = calloc(threads, sizeof(pthread_t));
+    int *started = calloc(threads, sizeof(int));
+    if (!tasks || !ids || !started) {
+        error = errno;
+        goto cleanup;
+    }
+
+    for (int i = 0; i < threads; ++i) {
+        Task *task = tasks + i;
+        task->filename = filename;
+        task->result = result;
+        task->begin = (uint64_t)tilesY * i / threads;
+        task->end = (uint64_t)tilesY * (i + 1) / threads;
+
+        // if the thread can't be created, its tiles are analyzed right here
+        started[i] = pthread_create(ids + i, NULL, work, task) == 0;
+        if (!started[i]) work(task);
+    }
+
+    // private counts of the threads are merged only once, at the end
+    Counts totals[3];
+    memset(totals, 0, sizeof(totals));
+
+    for (int i = 0; i < threads; ++i) {
+        if (started[i]) pthread_join(ids[i], NULL);
+        if (tasks[i].error != 0 && error == 0) error = tasks[i].error;
+        for (int c = 0; c < 3; ++c)
+            mergeCounts(totals + c, tasks[i].totals + c);
+    }
+
+    for (int c = 0; c < 3; ++c)
+        computeStats(totals + c, result->image + c);
+
+cleanup:
+    free(tasks);
+    free(ids);
+    free(started);
+    if (error != 0) destroyAnalysis(result);
+    return error;
+}
+
+
+void destroyAnalysis(Analysis *analysis) {
+    if (analysis->tiles) free(analysis->tiles);
+    analysis->tiles = NULL;
+    analysis->tilesCount = 0;
+}
@@ -11,6 +11,29 @@ static const size_t pixelsPositionOffset = 0x0A;
 static const size_t imageSizeOffset = 0x12;
 static const size_t imageRawSizeOffset = 0x22;
 static const size_t bitsPerPixelOffset = 0x1C;
+/// size of the file header together with `BITMAPINFOHEADER`
+static const size_t minimalHeaderSize = 0x36;
+
+/**
+ Internal function to check that the header is not malformed: the header itself is complete,
+ pixels count fits into `int` and all the rows of pixels fit into the file
+ 
+ - Returns: 0 if the header is valid, error code otherwise
+ */
+static int checkHeader(FILE *file, uint32_t pixelsPosition, uint32_t width, uint32_t height, uint16_t bitCount) {
+    if ((int32_t)width <= 0 || (int32_t)height <= 0 || bitCount == 0) return EFTYPE;
+    if (pixelsPosition < minimalHeaderSize) return EFTYPE;
+    if ((uint64_t)width * height > INT32_MAX) return EFTYPE;
+    
+    if (fseek(file, 0, SEEK_END) != 0) return errno;
+    long size = ftell(file);
+    if (size < 0) return errno;
+    
+    uint64_t rowSize = ((uint64_t)bitCount * width + 31) / 32 * 4;
+    if (pixelsPosition + rowSize * height > (uint64_t)size) return EFTYPE;
+    
+    return 0;
+}
 
 /**
  Internal function to load image, accepts a file descriptor and process it
@@ -20,8 +43,11 @@ static const size_t bitsPerPixelOffset = 0x1C;
 static int load(Image *image, FILE *file) {
     if (!file) return errno;
 
+    // fields stay zeroed if the file is too short, so `checkHeader` rejects it
+    image->width = image->height = 0;
+
     // read the offset to pixels
-    uint32_t pixelsPosition;
+    uint32_t pixelsPosition = 0;
     fseek(file, pixelsPositionOffset, SEEK_SET);
     if (ferror(file)) return errno;
     fread(&pixelsPosition, 4, 1, file);
@@ -37,12 +63,15 @@ static int load(Image *image, FILE *file) {
     if (image->height <= 0) return EFTYPE;
 
     // read bits per pixel
-    uint16_t bitCount;
+    uint16_t bitCount = 0;
     fseek(file, bitsPerPixelOffset, SEEK_SET);
     if (ferror(file)) return errno;
     fread(&bitCount, 2, 1, file);
     if (ferror(file)) return errno;
     
+    int error = checkHeader(file, pixelsPosition, image->width, image->height, bitCount);
+    if (error != 0) return error;
+    
     // read the pixels
     // sizeof(Pixel) == 3
     image->pixels = calloc(image->width * image->height, sizeof(Pixel));
@@ -206,3 +235,54 @@ void destoryImage(Image *image) {
     image->pixels = NULL;
     image->rawHeader = NULL;
 }
+
+
+int openBmp(BmpReader *reader, const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if (!file) return errno;
+    
+    int error = 0;
+    uint16_t bitCount = 0;
+    char signature[2];
+    
+    // same fields `load` reads, but pixels are left in the file
+    if (fread(signature, 2, 1, file) != 1
+        || fseek(file, pixelsPositionOffset, SEEK_SET) != 0
+        || fread(&reader->pixelsPosition, 4, 1, file) != 1
+        || fseek(file, imageSizeOffset, SEEK_SET) != 0
+        || fread(&reader->width, 4, 1, file) != 1
+        || fread(&reader->height, 4, 1, file) != 1
+        || fseek(file, bitsPerPixelOffset, SEEK_SET) != 0
+        || fread(&bitCount, 2, 1, file) != 1)
+        error = ferror(file) ? errno : EFTYPE;
+    
+    // only 24 bit images are supported
+    if (error == 0 && (signature[0] != 'B' || signature[1] != 'M' || bitCount != 24)) error = EFTYPE;
+    if (error == 0) error = checkHeader(file, reader->pixelsPosition, reader->width, reader->height, bitCount);
+    
+    if (error != 0) {
+        fclose(file);
+        return error;
+    }
+    
+    reader->file = file;
+    reader->stride = ((uint64_t)bitCount * reader->width + 31) / 32 * 4;
+    return 0;
+}
+
+
+int readBmpRows(BmpReader *reader, uint32_t firstRow, uint32_t count, unsigned char *buffer) {
+    long position = reader->pixelsPosition + (long)firstRow * reader->stride;
+    if (fseek(reader->file, position, SEEK_SET) != 0) return errno;
+    
+    if (fread(buffer, reader->stride, count, reader->file) != count)
+        return ferror(reader->file) ? errno : EFTYPE;
+    
+    return 0;
+}
+
+
+void closeBmp(BmpReader *reader) {
+    if (reader->file) fclose(reader->file);
+    reader->file = NULL;
+}
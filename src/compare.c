@@ -0,0 +1,347 @@
+#include "compare.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define COMPARE_AVX2 1
+#endif
+
+/// Approximate size of a band of rows read from each file at once
+#define COMPARE_BAND_SIZE (1 << 20)
+
+/// Statistics of a range of rows, merged into `Comparison` at the end
+typedef struct {
+    uint64_t changedBytes[3];
+    uint64_t changedLsb[3];
+    uint64_t lsbOnly[3];
+    uint64_t squaredError[3];
+    uint64_t absoluteError;
+    long minX, maxX, minY, maxY;
+} Stats;
+
+/**
+ Compares one row of components, `size` bytes long, the first byte is a blue component
+
+ - Parameter first: set to the index of the first differing byte, -1 if there is none
+ - Parameter last: set to the index of the last differing byte
+ */
+typedef void (*RowKernel)(const uint8_t *a, const uint8_t *b, size_t size, Stats *stats, long *first, long *last);
+
+/// Range of rows in the file order processed by one thread
+typedef struct {
+    const char *first, *second;
+    uint32_t begin, end;
+    RowKernel kernel;
+    Stats stats;
+    int error;
+} Task;
+
+
+/// Compares bytes from `begin` to `size` one by one
+static void compareTail(const uint8_t *a, const uint8_t *b, size_t begin, size_t size,
+                        Stats *stats, long *first, long *last) {
+    unsigned channel = begin % 3;
+
+    for (size_t i = begin; i < size; ++i) {
+        uint8_t changed = a[i] ^ b[i];
+
+        if (changed) {
+            if (*first < 0) *first = i;
+            *last = i;
+
+            unsigned diff = a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+            stats->changedBytes[channel] += 1;
+            stats->changedLsb[channel] += changed & 0x01;
+            stats->lsbOnly[channel] += changed == 0x01;
+            stats->squaredError[channel] += diff * diff;
+            stats->absoluteError += diff;
+        }
+
+        if (++channel == 3) channel = 0;
+    }
+}
+
+
+static void compareRowScalar(const uint8_t *a, const uint8_t *b, size_t size,
+                             Stats *stats, long *first, long *last) {
+    *first = -1;
+    *last = -1;
+    compareTail(a, b, 0, size, stats, first, last);
+}
+
+
+#ifdef COMPARE_AVX2
+
+/// Bits `j` of these masks are set if `j % 3 == residue`
+static const uint32_t residueMasks[3] = { 0x49249249, 0x92492492, 0x24924924 };
+
+/// Squared differences are accumulated in 32 bit lanes and moved to `stats` before they can overflow
+#define COMPARE_FLUSH_PERIOD 8192
+
+__attribute__((target("avx2,popcnt")))
+static void flushSquares(__m256i squares[3], Stats *stats) {
+    for (int c = 0; c < 3; ++c) {
+        uint32_t lanes[8];
+        _mm256_storeu_si256((__m256i *)lanes, squares[c]);
+        for (int i = 0; i < 8; ++i)
+            stats->squaredError[c] += lanes[i];
+        squares[c] = _mm256_setzero_si256();
+    }
+}
+
+
+__attribute__((target("avx2,popcnt")))
+static void compareRowAvx2(const uint8_t *a, const uint8_t *b, size_t size,
+                           Stats *stats, long *first, long *last) {
+    *first = -1;
+    *last = -1;
+
+    // 16 bit lanes with `j % 3 == residue`, to separate squares of different channels
+    __m256i residueLanes[3];
+    for (int r = 0; r < 3; ++r) {
+        int16_t lanes[16];
+        for (int j = 0; j < 16; ++j)
+            lanes[j] = j % 3 == r ? -1 : 0;
+        residueLanes[r] = _mm256_loadu_si256((const __m256i *)lanes);
+    }
+
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi8(1);
+    __m256i absolute = zero;
+    __m256i squares[3] = { zero, zero, zero };
+    unsigned steps = 0;
+
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+        __m256i x = _mm256_xor_si256(va, vb);
+
+        uint32_t changed = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, zero));
+        if (!changed) continue;
+
+        // lowest bit of each byte moved to the highest one
+        uint32_t lsb = _mm256_movemask_epi8(_mm256_slli_epi16(x, 7));
+        uint32_t only = _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, one));
+
+        // byte `j` of this vector belongs to the channel `(i + j) % 3`
+        unsigned phase = i % 3;
+        for (unsigned c = 0; c < 3; ++c) {
+            uint32_t mask = residueMasks[(c + 3 - phase) % 3];
+            stats->changedBytes[c] += __builtin_popcount(changed & mask);
+            stats->changedLsb[c] += __builtin_popcount(lsb & mask);
+            stats->lsbOnly[c] += __builtin_popcount(only & mask);
+        }
+
+        if (*first < 0) *first = i + __builtin_ctz(changed);
+        *last = i + 31 - __builtin_clz(changed);
+
+        __m256i diff = _mm256_or_si256(_mm256_subs_epu8(va, vb), _mm256_subs_epu8(vb, va));
+        absolute = _mm256_add_epi64(absolute, _mm256_sad_epu8(diff, zero));
+
+        __m256i low = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(diff));
+        __m256i high = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(diff, 1));
+        unsigned highPhase = (phase + 16) % 3;
+        for (unsigned c = 0; c < 3; ++c) {
+            __m256i lowMask = residueLanes[(c + 3 - phase) % 3];
+            __m256i highMask = residueLanes[(c + 3 - highPhase) % 3];
+            __m256i sum = _mm256_add_epi32(_mm256_madd_epi16(low, _mm256_and_si256(low, lowMask)),
+                                           _mm256_madd_epi16(high, _mm256_and_si256(high, highMask)));
+            squares[c] = _mm256_add_epi32(squares[c], sum);
+        }
+
+        if (++steps == COMPARE_FLUSH_PERIOD) {
+            flushSquares(squares, stats);
+            steps = 0;
+        }
+    }
+
+    flushSquares(squares, stats);
+
+    uint64_t sums[4];
+    _mm256_storeu_si256((__m256i *)sums, absolute);
+    stats->absoluteError += sums[0] + sums[1] + sums[2] + sums[3];
+
+    long tailFirst = -1, tailLast = -1;
+    compareTail(a, b, i, size, stats, &tailFirst, &tailLast);
+    if (tailFirst >= 0) {
+        if (*first < 0) *first = tailFirst;
+        *last = tailLast;
+    }
+}
+
+#endif
+
+
+static int avx2Supported(void) {
+#ifdef COMPARE_AVX2
+    return __builtin_cpu_supports("avx2");
+#else
+    return 0;
+#endif
+}
+
+
+static CompareKernel forcedKernel = COMPARE_KERNEL_AUTO;
+
+int compareSetKernel(CompareKernel kernel) {
+    if (kernel == COMPARE_KERNEL_AVX2 && !avx2Supported()) return ENOTSUP;
+    if (kernel != COMPARE_KERNEL_AUTO && kernel != COMPARE_KERNEL_SCALAR && kernel != COMPARE_KERNEL_AVX2)
+        return EINVAL;
+    forcedKernel = kernel;
+    return 0;
+}
+
+
+static RowKernel selectKernel(void) {
+#ifdef COMPARE_AVX2
+    if (forcedKernel == COMPARE_KERNEL_AVX2 || (forcedKernel == COMPARE_KERNEL_AUTO && avx2Supported()))
+        return compareRowAvx2;
+#endif
+    return compareRowScalar;
+}
+
+
+static int compareRows(Task *task) {
+    BmpReader a, b;
+    int error = openBmp(&a, task->first);
+    if (error != 0) return error;
+    error = openBmp(&b, task->second);
+    if (error != 0) { closeBmp(&a); return error; }
+
+    uint32_t bandRows = COMPARE_BAND_SIZE / a.stride;
+    if (bandRows == 0) bandRows = 1;
+
+    unsigned char *bandA = malloc((size_t)bandRows * a.stride);
+    unsigned char *bandB = malloc((size_t)bandRows * b.stride);
+    if (!bandA || !bandB) error = errno;
+
+    size_t rowSize = a.width * sizeof(Pixel);
+
+    for (uint32_t row = task->begin; error == 0 && row < task->end; row += bandRows) {
+        uint32_t count = task->end - row < bandRows ? task->end - row : bandRows;
+
+        error = readBmpRows(&a, row, count, bandA);
+        if (error == 0) error = readBmpRows(&b, row, count, bandB);
+        if (error != 0) break;
+
+        for (uint32_t r = 0; r < count; ++r) {
+            long first, last;
+            task->kernel(bandA + (size_t)r * a.stride, bandB + (size_t)r * b.stride,
+                         rowSize, &task->stats, &first, &last);
+            if (first < 0) continue;
+
+            // rows are stored from the bottom to the top
+            long y = a.height - 1 - (row + r);
+            if (first / 3 < task->stats.minX) task->stats.minX = first / 3;
+            if (last / 3 > task->stats.maxX) task->stats.maxX = last / 3;
+            if (y < task->stats.minY) task->stats.minY = y;
+            if (y > task->stats.maxY) task->stats.maxY = y;
+        }
+    }
+
+    free(bandA);
+    free(bandB);
+    closeBmp(&a);
+    closeBmp(&b);
+    return error;
+}
+
+
+static void *work(void *argument) {
+    Task *task = argument;
+    task->error = compareRows(task);
+    return NULL;
+}
+
+
+int compareBmp(Comparison *result, const char *first, const char *second, int threads) {
+    BmpReader a, b;
+    int error = openBmp(&a, first);
+    if (error != 0) return error;
+    error = openBmp(&b, second);
+    if (error != 0) { closeBmp(&a); return error; }
+
+    uint32_t width = a.width, height = a.height;
+    int sameSize = a.width == b.width && a.height == b.height;
+    closeBmp(&a);
+    closeBmp(&b);
+    if (!sameSize) return EINVAL;
+
+    if (threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int)cpus : 1;
+    }
+    if ((uint32_t)threads > height) threads = height;
+
+    Task *tasks = calloc(threads, sizeof(Task));
+    pthread_t *ids = calloc(threads, sizeof(pthread_t));
+    int *started = calloc(threads, sizeof(int));
+    if (!tasks || !ids || !started) {
+        error = errno;
+        free(tasks);
+        free(ids);
+        free(started);
+        return error;
+    }
+
+    RowKernel kernel = selectKernel();
+
+    for (int i = 0; i < threads; ++i) {
+        Task *task = tasks + i;
+        task->first = first;
+        task->second = second;
+        task->begin = (uint64_t)height * i / threads;
+        task->end = (uint64_t)height * (i + 1) / threads;
+        task->kernel = kernel;
+        task->stats.minX = width;
+        task->stats.minY = height;
+        task->stats.maxX = task->stats.maxY = -1;
+
+        // if the thread can't be created, its rows are compared right here
+        started[i] = pthread_create(ids + i, NULL, work, task) == 0;
+        if (!started[i]) work(task);
+    }
+
+    memset(result, 0, sizeof(Comparison));
+    result->width = width;
+    result->height = height;
+    long minX = width, maxX = -1, minY = height, maxY = -1;
+
+    for (int i = 0; i < threads; ++i) {
+        if (started[i]) pthread_join(ids[i], NULL);
+
+        const Stats *stats = &tasks[i].stats;
+        if (tasks[i].error != 0 && error == 0) error = tasks[i].error;
+
+        for (int c = 0; c < 3; ++c) {
+            result->changedBytes[c] += stats->changedBytes[c];
+            result->changedLsb[c] += stats->changedLsb[c];
+            result->lsbOnly[c] += stats->lsbOnly[c];
+            result->squaredError[c] += stats->squaredError[c];
+        }
+        result->absoluteError += stats->absoluteError;
+
+        if (stats->minX < minX) minX = stats->minX;
+        if (stats->maxX > maxX) maxX = stats->maxX;
+        if (stats->minY < minY) minY = stats->minY;
+        if (stats->maxY > maxY) maxY = stats->maxY;
+    }
+
+    if (maxX >= 0) {
+        result->box.x = minX;
+        result->box.y = minY;
+        result->box.w = maxX - minX + 1;
+        result->box.h = maxY - minY + 1;
+    }
+
+    free(tasks);
+    free(ids);
+    free(started);
+    return error;
+}
@@ -1,48 +1,68 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include "bmp.h"
 #include "stego.h"
+#include "scan.h"
+#include "compare.h"
+#include "analyze.h"
 
 #define BADARGS do { printUsage(); return FAILED; } while(0);
 
-/// This program can run in 3 different mods depending on the command line arguments
+/// This program can run in 6 different mods depending on the command line arguments
 /// `FAILED` mode is used for error handling
-typedef enum { TRANSFORM, INSERT, EXTRACT, FAILED } Mode;
+typedef enum { TRANSFORM, INSERT, EXTRACT, SCAN, COMPARE, ANALYZE, FAILED } Mode;
 
 typedef struct {
     const char* input;
     const char* output;
     const char* key;
     const char* message;
+    const char* compared;
 } IOFiles;
 
+/// Options of the modes which process files in parallel, valid fields depend on the mode as well
+typedef struct {
+    int threads;
+    int tileSize;
+    const char* stopPrefix;
+    int stopOnValid;
+} Options;
+
 /// Number of arguments in each mode
 static const int transformModeArgsCount = 8;
 static const int insertModeArgsCount = 6;
 static const int extractModeArgsCount = 5;
+static const int scanModeArgsCount = 4;
+static const int compareModeArgsCount = 4;
+static const int analyzeModeArgsCount = 3;
 
 void printUsage(void) {
     puts("Usage: bin/hw_01 crop-rotate ‹in-bmp› ‹out-bmp› ‹x› ‹y› ‹w› ‹h›");
     puts("Or     bin/hw_01 insert ‹in-bmp› ‹out-bmp› ‹key-txt› ‹msg-txt›");
     puts("Or     bin/hw_01 extract ‹in-bmp› ‹key-txt› ‹msg-txt›");
+    puts("Or     bin/hw_01 scan ‹dir› ‹key-txt› [--stop-prefix ‹prefix› | --stop-valid] [--threads ‹n›]");
+    puts("Or     bin/hw_01 compare ‹a-bmp› ‹b-bmp› [--threads ‹n›]");
+    puts("Or     bin/hw_01 analyze ‹in-bmp› [--tile ‹size›] [--threads ‹n›]");
 }
 
 /**
  Extracts arguments and determines the mode in which programm will be running.
  
  `rect` and `files` will have valid information only if function returns 0, otherwise the contents of this structs is undefined.
- Valied content in these structs depends on the mode returned. `rect` struct will be filled only in `TRANSFORM` mode. `IOFiles` struct
- will be containing different valid strings depending on the mode as well.
+ Valied content in these structs depends on the mode returned. `rect` struct will be filled only in `TRANSFORM` mode,
+ `options` struct only in `SCAN`, `COMPARE` and `ANALYZE` modes. `IOFiles` struct will be containing different valid strings depending on the mode as well.
  
  - Parameter argc: Number of the command line arguments
  - Parameter argv: Array of string arguments
  - Parameter rect: Pointer to a `Rect` struct, which will be initialized by this function
  - Parameter files: Pointer to a `IOFiles` struct, initializes by this function as well
+ - Parameter options: Pointer to an `Options` struct, initializes by this function as well
  
- - Returns: `TRANSFORM`, `INSERT` or `EXTRACT` mode in case arguments were properly parsed. `FAILED` mode if error occured.
+ - Returns: `TRANSFORM`, `INSERT`, `EXTRACT`, `SCAN`, `COMPARE` or `ANALYZE` mode in case arguments were properly parsed. `FAILED` mode if error occured.
  */
-Mode extractArgs(int argc, const char * argv[], Rect* rect, IOFiles* files) {
+Mode extractArgs(int argc, const char * argv[], Rect* rect, IOFiles* files, Options* options) {
     if (argc < 2) BADARGS;
     
     Mode mode;
@@ -80,6 +100,63 @@ Mode extractArgs(int argc, const char * argv[], Rect* rect, IOFiles* files) {
         files->key = argv[3];
         files->message = argv[4];
     }
+    else if (strcmp(argv[1], "scan") == 0) {
+        mode = SCAN;
+        
+        if (argc < scanModeArgsCount) BADARGS;
+        
+        // `input` is a directory in this mode
+        files->input = argv[2];
+        files->key = argv[3];
+        
+        options->stopPrefix = NULL;
+        options->stopOnValid = 0;
+        options->threads = 0;
+        
+        for (int i = scanModeArgsCount; i < argc; ++i) {
+            if (strcmp(argv[i], "--stop-prefix") == 0 && i + 1 < argc)
+                options->stopPrefix = argv[++i];
+            else if (strcmp(argv[i], "--stop-valid") == 0)
+                options->stopOnValid = 1;
+            else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+                options->threads = atoi(argv[++i]);
+            else BADARGS;
+        }
+    }
+    else if (strcmp(argv[1], "compare") == 0) {
+        mode = COMPARE;
+        
+        if (argc != compareModeArgsCount && argc != compareModeArgsCount + 2) BADARGS;
+        
+        files->input = argv[2];
+        files->compared = argv[3];
+        
+        options->threads = 0;
+        if (argc > compareModeArgsCount) {
+            if (strcmp(argv[compareModeArgsCount], "--threads") != 0) BADARGS;
+            options->threads = atoi(argv[compareModeArgsCount + 1]);
+        }
+    }
+    else if (strcmp(argv[1], "analyze") == 0) {
+        mode = ANALYZE;
+        
+        if (argc < analyzeModeArgsCount) BADARGS;
+        
+        files->input = argv[2];
+        
+        options->threads = 0;
+        options->tileSize = ANALYZE_DEFAULT_TILE_SIZE;
+        
+        for (int i = analyzeModeArgsCount; i < argc; ++i) {
+            if (strcmp(argv[i], "--tile") == 0 && i + 1 < argc)
+                options->tileSize = atoi(argv[++i]);
+            else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+                options->threads = atoi(argv[++i]);
+            else BADARGS;
+        }
+        
+        if (options->tileSize <= 0) BADARGS;
+    }
     else BADARGS;
     
     return mode;
@@ -97,6 +174,15 @@ int insertModeHandler(Image *image, IOFiles *filesnames);
 /// Decodes message from the `image` according to the provided key file.
 int extractModeHandler(Image *image, IOFiles *filesnames);
 
+/// Decodes messages from all `bmp` files in the directory with the same key, doesn't need an image loaded
+int scanModeHandler(IOFiles *filesnames, Options *options);
+
+/// Compares two `bmp` files and prints the statistics of their difference, doesn't need an image loaded
+int compareModeHandler(IOFiles *filesnames, Options *options);
+
+/// Prints LSB embedding statistics of the `bmp` file for the whole image and for each tile, doesn't need an image loaded
+int analyzeModeHandler(IOFiles *filesnames, Options *options);
+
 
 /// Entry point of the programm
 /// - Parameters:
@@ -105,8 +191,12 @@ int extractModeHandler(Image *image, IOFiles *filesnames);
 int main(int argc, const char * argv[]) {
     Rect rect;
     IOFiles filenames;
-    Mode mode = extractArgs(argc, argv, &rect, &filenames);
+    Options options;
+    Mode mode = extractArgs(argc, argv, &rect, &filenames, &options);
     if (mode == FAILED) return 1;
+    if (mode == SCAN) return scanModeHandler(&filenames, &options);
+    if (mode == COMPARE) return compareModeHandler(&filenames, &options);
+    if (mode == ANALYZE) return analyzeModeHandler(&filenames, &options);
     
     Image image;
     int error = loadBmp(&image, filenames.input);
@@ -125,6 +215,9 @@ int main(int argc, const char * argv[]) {
         case EXTRACT:
             error = extractModeHandler(&image, &filenames);
             break;
+        case SCAN:
+        case COMPARE:
+        case ANALYZE:
         case FAILED:
             fputs("Unknows error", stderr);
             destoryImage(&image);
@@ -198,3 +291,103 @@ int extractModeHandler(Image *image, IOFiles *filenames) {
     
     return 0;
 }
+
+
+int scanModeHandler(IOFiles *filenames, Options *options) {
+    Key key;
+    int error = loadKey(&key, filenames->key);
+    if (error != 0) {
+        fprintf(stderr, "%s: error while loading the key: %s\n", filenames->key, strerror(error));
+        return 1;
+    }
+    
+    ScanOptions scanOptions = {
+        .stopPrefix = options->stopPrefix,
+        .stopOnValid = options->stopOnValid,
+        .threads = options->threads
+    };
+    error = scanDirectory(filenames->input, &key, &scanOptions);
+    destroyKey(&key);
+    if (error != 0) {
+        fprintf(stderr, "%s: error while scanning the directory: %s\n", filenames->input, strerror(error));
+        return 1;
+    }
+    
+    return 0;
+}
+
+
+int compareModeHandler(IOFiles *filenames, Options *options) {
+    Comparison result;
+    int error = compareBmp(&result, filenames->input, filenames->compared, options->threads);
+    if (error != 0) {
+        fprintf(stderr, "%s, %s: error while comparing the files: %s\n",
+                filenames->input, filenames->compared, strerror(error));
+        return 1;
+    }
+    
+    uint64_t pixels = (uint64_t)result.width * result.height;
+    uint64_t changed = 0, changedLsb = 0, squaredError = 0;
+    
+    printf("size: %u x %u\n", result.width, result.height);
+    printf("channel  changed  changed-lsb  lsb-only  mse  psnr\n");
+    
+    const char names[] = { 'B', 'G', 'R' };
+    for (int c = 0; c < 3; ++c) {
+        changed += result.changedBytes[c];
+        changedLsb += result.changedLsb[c];
+        squaredError += result.squaredError[c];
+        
+        double mse = (double)result.squaredError[c] / pixels;
+        printf("%c  %llu  %llu  %llu  %.6f  %.2f\n", names[c],
+               (unsigned long long)result.changedBytes[c],
+               (unsigned long long)result.changedLsb[c],
+               (unsigned long long)result.lsbOnly[c],
+               mse, 10 * log10(255.0 * 255.0 / mse));
+    }
+    
+    double mse = (double)squaredError / (3 * pixels);
+    printf("total  %llu  %llu  -  %.6f  %.2f\n",
+           (unsigned long long)changed, (unsigned long long)changedLsb,
+           mse, 10 * log10(255.0 * 255.0 / mse));
+    printf("mean absolute error: %.6f\n", (double)result.absoluteError / (3 * pixels));
+    
+    if (result.box.w == 0)
+        puts("bounding box: none");
+    else
+        printf("bounding box: origin (%d, %d), size (%d, %d)\n",
+               result.box.x, result.box.y, result.box.w, result.box.h);
+    
+    return 0;
+}
+
+
+int analyzeModeHandler(IOFiles *filenames, Options *options) {
+    Analysis analysis;
+    int error = analyzeBmp(&analysis, filenames->input, options->tileSize, options->threads);
+    if (error != 0) {
+        fprintf(stderr, "%s: error while analyzing the file: %s\n", filenames->input, strerror(error));
+        return 1;
+    }
+    
+    printf("size: %u x %u, tile: %d\n", analysis.width, analysis.height, analysis.tileSize);
+    printf("channel  chi-square  probability  rs-estimate\n");
+    
+    const char names[] = { 'B', 'G', 'R' };
+    for (int c = 0; c < 3; ++c)
+        printf("%c  %.2f  %.4f  %.4f\n", names[c],
+               analysis.image[c].chiSquare, analysis.image[c].probability, analysis.image[c].rsEstimate);
+    
+    // one line per tile: rectangle, then probability and RS estimate for B, G and R
+    printf("tiles: x y w h  B-probability B-rs  G-probability G-rs  R-probability R-rs\n");
+    for (size_t i = 0; i < analysis.tilesCount; ++i) {
+        const TileAnalysis *tile = analysis.tiles + i;
+        printf("%d %d %d %d", tile->rect.x, tile->rect.y, tile->rect.w, tile->rect.h);
+        for (int c = 0; c < 3; ++c)
+            printf("  %.4f %.4f", tile->channels[c].probability, tile->channels[c].rsEstimate);
+        putchar('\n');
+    }
+    
+    destroyAnalysis(&analysis);
+    return 0;
+}
@@ -0,0 +1,358 @@
+#include "scan.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+
+/// Size of the block read from the file at once
+#define SCAN_BLOCK_SIZE 4096
+
+/// Growable list of file paths found in the directory tree
+typedef struct {
+    size_t count, capacity;
+    char **paths;
+} PathList;
+
+/// Range `[head, tail)` of paths owned by one worker, other workers steal from its tail
+typedef struct {
+    pthread_mutex_t lock;
+    size_t head, tail;
+} Queue;
+
+/**
+ Key bit with its position in a bmp file
+
+ `position` orders components like bytes in a file: rows from the bottom to the top, then columns, then channels.
+ It doesn't depend on the image size, so it's computed once for all files.
+ */
+typedef struct {
+    uint64_t position;
+    size_t index;
+} KeyOrder;
+
+/// State shared by all workers
+typedef struct {
+    const PathList *files;
+    const Key *key;
+    const ScanOptions *options;
+    size_t prefixLength;
+
+    /// key bits sorted by their position in a file
+    KeyOrder *order;
+
+    int workersCount;
+    Queue *queues;
+    atomic_int stop;
+} Scan;
+
+typedef struct {
+    Scan *scan;
+    int index;
+
+    /// last read block of the current file
+    unsigned char block[SCAN_BLOCK_SIZE];
+    off_t blockStart;
+    ssize_t blockSize;
+} Worker;
+
+
+static int appendPath(PathList *list, char *path) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 64;
+        char **paths = realloc(list->paths, capacity * sizeof(char *));
+        if (!paths) return errno;
+        list->paths = paths;
+        list->capacity = capacity;
+    }
+    list->paths[list->count++] = path;
+    return 0;
+}
+
+
+static int hasBmpExtension(const char *name) {
+    size_t length = strlen(name);
+    return length > 4 && strcasecmp(name + length - 4, ".bmp") == 0;
+}
+
+
+/// Recursively collects all `.bmp` files, symbolic links are not followed
+static int collect(PathList *list, const char *directory) {
+    DIR *dir = opendir(directory);
+    if (!dir) return errno;
+
+    int error = 0;
+    struct dirent *entry;
+
+    while (error == 0 && (entry = readdir(dir))) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+
+        size_t length = strlen(directory) + strlen(entry->d_name) + 2;
+        char *path = malloc(length);
+        if (!path) { error = errno; break; }
+        snprintf(path, length, "%s/%s", directory, entry->d_name);
+
+        struct stat info;
+        if (lstat(path, &info) != 0) {
+            fprintf(stderr, "%s: %s\n", path, strerror(errno));
+            free(path);
+            continue;
+        }
+
+        if (S_ISDIR(info.st_mode)) {
+            error = collect(list, path);
+            // unreadable subdirectories should not stop the whole scan
+            if (error != 0) fprintf(stderr, "%s: %s\n", path, strerror(error));
+            error = 0;
+            free(path);
+        }
+        else if (S_ISREG(info.st_mode) && hasBmpExtension(entry->d_name)) {
+            error = appendPath(list, path);
+            if (error != 0) free(path);
+        }
+        else free(path);
+    }
+
+    closedir(dir);
+    return error;
+}
+
+
+static void destroyPathList(PathList *list) {
+    for (size_t i = 0; i < list->count; ++i)
+        free(list->paths[i]);
+    free(list->paths);
+}
+
+
+/// Position of the key bit in the file layout, see `KeyOrder`
+static uint64_t keyPosition(const KeyBit *bit) {
+    // bits out of the `int32_t` range can't belong to any image, their order doesn't matter
+    uint64_t y = bit->y > INT32_MAX ? INT32_MAX : bit->y;
+    uint64_t x = bit->x > INT32_MAX ? INT32_MAX : bit->x;
+    // 31 bits for the inverted row, 33 bits for the byte inside the row
+    return (INT32_MAX - y) << 33 | (x * sizeof(Pixel) + bit->channel);
+}
+
+
+static int compareKeyOrders(const void *lhs, const void *rhs) {
+    uint64_t a = ((const KeyOrder *)lhs)->position;
+    uint64_t b = ((const KeyOrder *)rhs)->position;
+    return (a > b) - (a < b);
+}
+
+
+/// Reads one byte at `offset`, blocks are only read forward, so `offset`s should be non-decreasing
+static int readByte(Worker *worker, int fd, off_t offset, unsigned char *byte) {
+    if (offset < worker->blockStart || offset >= worker->blockStart + worker->blockSize) {
+        worker->blockStart = offset;
+        worker->blockSize = pread(fd, worker->block, SCAN_BLOCK_SIZE, offset);
+        if (worker->blockSize < 0) { worker->blockSize = 0; return errno; }
+        if (worker->blockSize == 0) return EFTYPE;
+    }
+    *byte = worker->block[offset - worker->blockStart];
+    return 0;
+}
+
+
+/**
+ Extracts message from the bmp file without loading the whole image
+
+ `message` should be able to hold `STEGO_MESSAGE_MAX_LENGTH + 1` characters
+
+ - Parameter valid: set to 1 if all characters of the message are in the alphabet, 0 otherwise
+
+ - Returns: 0 on success, error code on failure
+ */
+static int extractFromFile(Worker *worker, const char *path, char *message, int *valid) {
+    const Scan *scan = worker->scan;
+
+    // the header is validated by `openBmp`, pixels are read directly from its descriptor
+    BmpReader reader;
+    int error = openBmp(&reader, path);
+    if (error != 0) return error;
+    int fd = fileno(reader.file);
+
+    size_t length = scan->key->length / 5;
+    uint8_t codes[STEGO_MESSAGE_MAX_LENGTH] = {0};
+    worker->blockStart = 0;
+    worker->blockSize = 0;
+
+    for (size_t i = 0; error == 0 && i < scan->key->length; ++i) {
+        size_t index = scan->order[i].index;
+        const KeyBit *bit = scan->key->bits + index;
+        if (bit->x >= reader.width || bit->y >= reader.height) { error = EFTYPE; break; }
+
+        off_t offset = reader.pixelsPosition + (off_t)(reader.height - 1 - bit->y) * reader.stride
+                     + (off_t)bit->x * sizeof(Pixel) + bit->channel;
+
+        unsigned char component = 0;
+        error = readByte(worker, fd, offset, &component);
+        if (error != 0) break;
+
+        // every 5 lines of the key encode one code starting from the lowest bit
+        codes[index / 5] |= (component & 0x01) << (index % 5);
+    }
+
+    closeBmp(&reader);
+    if (error != 0) return error;
+
+    // codes are stored from the last character to the first one, same as `decode` does
+    *valid = length > 0;
+    for (size_t i = 0; i < length; ++i) {
+        char symbol = decodeSymbol(codes[length - 1 - i]);
+        if (!symbol) { symbol = '?'; *valid = 0; }
+        message[i] = symbol;
+    }
+    message[length] = '\0';
+
+    return 0;
+}
+
+
+/// Takes next file index, steals half of the remaining work of another worker if own queue is empty
+/// - Returns: 1 if `file` was set, 0 if there is no work left
+static int nextFile(Worker *worker, size_t *file) {
+    Scan *scan = worker->scan;
+    Queue *own = scan->queues + worker->index;
+
+    pthread_mutex_lock(&own->lock);
+    int found = own->head < own->tail;
+    if (found) *file = own->head++;
+    pthread_mutex_unlock(&own->lock);
+    if (found) return 1;
+
+    for (int i = 1; i < scan->workersCount; ++i) {
+        Queue *victim = scan->queues + (worker->index + i) % scan->workersCount;
+
+        pthread_mutex_lock(&victim->lock);
+        size_t remaining = victim->tail - victim->head;
+        size_t stolen = (remaining + 1) / 2;
+        size_t tail = victim->tail;
+        victim->tail -= stolen;
+        pthread_mutex_unlock(&victim->lock);
+
+        if (stolen == 0) continue;
+
+        // the first stolen file is taken right away, the rest goes to the own queue
+        pthread_mutex_lock(&own->lock);
+        own->head = tail - stolen + 1;
+        own->tail = tail;
+        pthread_mutex_unlock(&own->lock);
+
+        *file = tail - stolen;
+        return 1;
+    }
+
+    return 0;
+}
+
+
+static void *work(void *argument) {
+    Worker *worker = argument;
+    Scan *scan = worker->scan;
+    const ScanOptions *options = scan->options;
+
+    char message[STEGO_MESSAGE_MAX_LENGTH + 1];
+    size_t file;
+
+    while (!atomic_load(&scan->stop) && nextFile(worker, &file)) {
+        const char *path = scan->files->paths[file];
+
+        int valid = 0;
+        int error = extractFromFile(worker, path, message, &valid);
+        if (error != 0) {
+            fprintf(stderr, "%s: error while reading the file: %s\n", path, strerror(error));
+            continue;
+        }
+
+        flockfile(stdout);
+        printf("%s\t%s\n", path, message);
+        fflush(stdout);
+        funlockfile(stdout);
+
+        if ((options->stopPrefix && strncmp(message, options->stopPrefix, scan->prefixLength) == 0)
+            || (options->stopOnValid && valid))
+            atomic_store(&scan->stop, 1);
+    }
+
+    return NULL;
+}
+
+
+int scanDirectory(const char *directory, const Key *key, const ScanOptions *options) {
+    PathList files = {0};
+    int error = collect(&files, directory);
+    if (error != 0 || files.count == 0) {
+        destroyPathList(&files);
+        return error;
+    }
+
+    Scan scan = {
+        .files = &files,
+        .key = key,
+        .options = options,
+        .prefixLength = options->stopPrefix ? strlen(options->stopPrefix) : 0,
+        .workersCount = options->threads
+    };
+    atomic_init(&scan.stop, 0);
+
+    if (scan.workersCount <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        scan.workersCount = cpus > 0 ? (int)cpus : 1;
+    }
+    if ((size_t)scan.workersCount > files.count) scan.workersCount = (int)files.count;
+
+    // sort the key once, so every file is read from the beginning to the end
+    scan.order = malloc((key->length ? key->length : 1) * sizeof(KeyOrder));
+    scan.queues = calloc(scan.workersCount, sizeof(Queue));
+    Worker *workers = calloc(scan.workersCount, sizeof(Worker));
+    pthread_t *threads = calloc(scan.workersCount, sizeof(pthread_t));
+    if (!scan.order || !scan.queues || !workers || !threads) {
+        error = errno;
+        goto cleanup;
+    }
+
+    for (size_t i = 0; i < key->length; ++i) {
+        scan.order[i].position = keyPosition(key->bits + i);
+        scan.order[i].index = i;
+    }
+    qsort(scan.order, key->length, sizeof(KeyOrder), compareKeyOrders);
+
+    // initially every worker owns an equal contiguous part of the files
+    for (int i = 0; i < scan.workersCount; ++i) {
+        pthread_mutex_init(&scan.queues[i].lock, NULL);
+        scan.queues[i].head = files.count * i / scan.workersCount;
+        scan.queues[i].tail = files.count * (i + 1) / scan.workersCount;
+        workers[i].scan = &scan;
+        workers[i].index = i;
+    }
+
+    int started = 0;
+    for (; started < scan.workersCount; ++started) {
+        error = pthread_create(threads + started, NULL, work, workers + started);
+        if (error != 0) break;
+    }
+    // if some threads failed to start, the started ones will steal their work
+    if (started > 0) error = 0;
+
+    for (int i = 0; i < started; ++i)
+        pthread_join(threads[i], NULL);
+
+    for (int i = 0; i < scan.workersCount; ++i)
+        pthread_mutex_destroy(&scan.queues[i].lock);
+
+cleanup:
+    free(threads);
+    free(workers);
+    free(scan.queues);
+    free(scan.order);
+    destroyPathList(&files);
+    return error;
+}
@@ -4,6 +4,7 @@
 #include <string.h>
 #include <errno.h>
 #include <assert.h>
+#include <stddef.h>
 
 static const char table[] = {
     [0b00000001] = 'A',
@@ -193,3 +194,71 @@ int decode(const Image *image, const char *keyFile, const char* filename) {
     fclose(message);
     return error;
 }
+
+
+char decodeSymbol(uint8_t code) {
+    // `table` has no entry for the largest 5-bit code
+    if (code >= sizeof(table)) return 0;
+    return table[code];
+}
+
+
+int loadKey(Key *key, const char *keyFile) {
+    FILE *file = fopen(keyFile, "r");
+    if (!file) return errno;
+    
+    int error = 0;
+    size_t capacity = 5 * 16;
+    
+    key->length = 0;
+    key->bits = malloc(capacity * sizeof(KeyBit));
+    if (!key->bits) { error = errno; fclose(file); return error; }
+    
+    size_t size;
+    char *instruction = NULL;
+    
+    while (key->length < 5 * STEGO_MESSAGE_MAX_LENGTH && getline(&instruction, &size, file) >= 0) {
+        if (key->length == capacity) {
+            capacity *= 2;
+            KeyBit *bits = realloc(key->bits, capacity * sizeof(KeyBit));
+            if (!bits) { error = errno; break; }
+            key->bits = bits;
+        }
+        
+        // a line is `x y C`, lines without any of the parts are malformed
+        char *temp = instruction;
+        char *x = strsep(&temp, " ");
+        char *y = strsep(&temp, " ");
+        if (!x || !*x || !y || !*y || !temp) { error = EFTYPE; break; }
+        
+        KeyBit *bit = key->bits + key->length;
+        bit->x = atoi(x);
+        bit->y = atoi(y);
+        
+        switch (temp[0]) {
+            case 'B': bit->channel = offsetof(Pixel, b); break;
+            case 'G': bit->channel = offsetof(Pixel, g); break;
+            case 'R': bit->channel = offsetof(Pixel, r); break;
+            default: error = EFTYPE;
+        }
+        if (error != 0) break;
+        
+        ++key->length;
+    }
+    if (error == 0 && ferror(file)) error = errno;
+    
+    // the tail which doesn't form a whole character is ignored
+    key->length -= key->length % 5;
+    
+    free(instruction);
+    fclose(file);
+    if (error != 0) destroyKey(key);
+    return error;
+}
+
+
+void destroyKey(Key *key) {
+    if (key->bits) free(key->bits);
+    key->bits = NULL;
+    key->length = 0;
+}
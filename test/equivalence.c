@@ -0,0 +1,472 @@
+#include "reference.h"
+#include "fuzz_bmp.h"
+#include "bmp.h"
+#include "stego.h"
+#include "scan.h"
+#include "compare.h"
+#include "analyze.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Differential test: every routine in `src` is compared with its reference on random images,
+// rectangles, keys and messages. Then the fuzzer entry point is run on randomly corrupted headers.
+//
+// Usage: bin/equivalence [iterations] [seed]
+
+#define CHECK(condition, what) do { \
+    if (!(condition)) { fprintf(stderr, "iteration %d: %s\n", iteration, what); return 1; } \
+} while (0)
+
+/// Size of the header written to the generated files
+static const size_t headerSize = 54;
+
+static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ ,.";
+
+/// All generated files live in this directory
+static char directory[] = "/tmp/equivalence-XXXXXX";
+static char scanDirectoryPath[64];
+static char inputPath[64], outputPath[64], referencePath[64];
+static char keyPath[64], messagePath[64], capturePath[64], scannedPath[64];
+
+
+static int randomRange(int low, int high) {
+    return low + rand() % (high - low + 1);
+}
+
+
+static size_t rowStride(uint32_t width) {
+    return (width * sizeof(Pixel) + 3) / 4 * 4;
+}
+
+
+/// Writes a random 24 bit image, `pixels` receives its contents from the top left corner
+static size_t randomBmp(unsigned char *file, uint32_t width, uint32_t height, Pixel *pixels) {
+    size_t stride = rowStride(width);
+    uint32_t rawSize = stride * height;
+    uint32_t fileSize = headerSize + rawSize;
+
+    memset(file, 0, fileSize);
+    file[0] = 'B';
+    file[1] = 'M';
+    memcpy(file + 0x02, &fileSize, 4);
+    uint32_t pixelsPosition = headerSize, infoSize = 40;
+    memcpy(file + 0x0A, &pixelsPosition, 4);
+    memcpy(file + 0x0E, &infoSize, 4);
+    memcpy(file + 0x12, &width, 4);
+    memcpy(file + 0x16, &height, 4);
+    uint16_t planes = 1, bitCount = 24;
+    memcpy(file + 0x1A, &planes, 2);
+    memcpy(file + 0x1C, &bitCount, 2);
+    memcpy(file + 0x22, &rawSize, 4);
+
+    for (uint32_t y = 0; y < height; ++y) {
+        unsigned char *row = file + headerSize + (size_t)(height - 1 - y) * stride;
+        for (uint32_t x = 0; x < width; ++x) {
+            Pixel *pixel = pixels + (size_t)y * width + x;
+            pixel->b = rand();
+            pixel->g = rand();
+            pixel->r = rand();
+            memcpy(row + x * sizeof(Pixel), pixel, sizeof(Pixel));
+        }
+    }
+
+    return fileSize;
+}
+
+
+static int writeFile(const char *path, const void *data, size_t size) {
+    FILE *file = fopen(path, "wb");
+    if (!file) return 0;
+    int good = fwrite(data, 1, size, file) == size;
+    return fclose(file) == 0 && good;
+}
+
+
+/// Reads the whole file, returns `NULL` on error
+static char *readFile(const char *path, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    if (!file) return NULL;
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *data = malloc(*size + 1);
+    if (data && fread(data, 1, *size, file) != *size) { free(data); data = NULL; }
+    if (data) data[*size] = '\0';
+    fclose(file);
+    return data;
+}
+
+
+static int sameFiles(const char *first, const char *second) {
+    size_t firstSize, secondSize;
+    char *a = readFile(first, &firstSize);
+    char *b = readFile(second, &secondSize);
+    int same = a && b && firstSize == secondSize && memcmp(a, b, firstSize) == 0;
+    free(a);
+    free(b);
+    return same;
+}
+
+
+static int copyImage(Image *to, const Image *from) {
+    uint32_t pixelsPosition;
+    memcpy(&pixelsPosition, from->rawHeader + 0x0A, 4);
+    size_t size = (size_t)from->width * from->height * sizeof(Pixel);
+
+    to->width = from->width;
+    to->height = from->height;
+    to->pixels = malloc(size ? size : 1);
+    to->rawHeader = malloc(pixelsPosition);
+    if (!to->pixels || !to->rawHeader) return 0;
+
+    memcpy(to->pixels, from->pixels, size);
+    memcpy(to->rawHeader, from->rawHeader, pixelsPosition);
+    return 1;
+}
+
+
+static int sameImages(const Image *a, const Image *b) {
+    return a->width == b->width && a->height == b->height
+        && memcmp(a->pixels, b->pixels, (size_t)a->width * a->height * sizeof(Pixel)) == 0;
+}
+
+
+/**
+ Writes a key with `length` lines, without the trailing newline: `decode` reads one more garbage character after it.
+ Components are distinct while there are enough of them, so the message can be read back.
+ */
+static int writeKey(const char *path, int length, uint32_t width, uint32_t height) {
+    FILE *file = fopen(path, "w");
+    if (!file) return 0;
+
+    size_t components = (size_t)width * height * 3;
+    size_t *order = malloc(components * sizeof(size_t));
+    if (!order) { fclose(file); return 0; }
+
+    for (size_t i = 0; i < components; ++i)
+        order[i] = i;
+    for (size_t i = components - 1; i > 0; --i) {
+        size_t j = rand() % (i + 1);
+        size_t temp = order[i];
+        order[i] = order[j];
+        order[j] = temp;
+    }
+
+    for (int i = 0; i < length; ++i) {
+        size_t component = order[i % components];
+        size_t pixel = component / 3;
+        fprintf(file, "%s%zu %zu %c", i ? "\n" : "", pixel % width, pixel / width, "BGR"[component % 3]);
+    }
+
+    free(order);
+    return fclose(file) == 0;
+}
+
+
+static int writeMessage(const char *path, char *message, int length) {
+    for (int i = 0; i < length; ++i)
+        message[i] = alphabet[rand() % (sizeof(alphabet) - 1)];
+    message[length] = '\0';
+    return writeFile(path, message, length);
+}
+
+
+/// Runs `scanDirectory` with `stdout` redirected to `capturePath`
+static int captureScan(const Key *key, const ScanOptions *options) {
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int fd = open(capturePath, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (saved < 0 || fd < 0) return -1;
+
+    dup2(fd, STDOUT_FILENO);
+    close(fd);
+    int error = scanDirectory(scanDirectoryPath, key, options);
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    return error;
+}
+
+
+/// Straightforward version of `compareBmp` on the loaded images
+static void naiveComparison(const Image *a, const Image *b, Comparison *result) {
+    memset(result, 0, sizeof(Comparison));
+    result->width = a->width;
+    result->height = a->height;
+    long minX = a->width, maxX = -1, minY = a->height, maxY = -1;
+
+    for (uint32_t y = 0; y < a->height; ++y)
+        for (uint32_t x = 0; x < a->width; ++x)
+            for (int c = 0; c < 3; ++c) {
+                int first = ((const unsigned char *)(a->pixels + y * a->width + x))[c];
+                int second = ((const unsigned char *)(b->pixels + y * b->width + x))[c];
+                if (first == second) continue;
+
+                int changed = first ^ second;
+                int diff = abs(first - second);
+                result->changedBytes[c] += 1;
+                result->changedLsb[c] += changed & 1;
+                result->lsbOnly[c] += changed == 1;
+                result->squaredError[c] += diff * diff;
+                result->absoluteError += diff;
+                if ((long)x < minX) minX = x;
+                if ((long)x > maxX) maxX = x;
+                if ((long)y < minY) minY = y;
+                if ((long)y > maxY) maxY = y;
+            }
+
+    if (maxX >= 0) {
+        result->box.x = minX;
+        result->box.y = minY;
+        result->box.w = maxX - minX + 1;
+        result->box.h = maxY - minY + 1;
+    }
+}
+
+
+static int sameComparisons(const Comparison *a, const Comparison *b) {
+    if (a->width != b->width || a->height != b->height || a->absoluteError != b->absoluteError) return 0;
+    if (memcmp(&a->box, &b->box, sizeof(Rect)) != 0) return 0;
+    for (int c = 0; c < 3; ++c)
+        if (a->changedBytes[c] != b->changedBytes[c] || a->changedLsb[c] != b->changedLsb[c]
+            || a->lsbOnly[c] != b->lsbOnly[c] || a->squaredError[c] != b->squaredError[c])
+            return 0;
+    return 1;
+}
+
+
+/// Bands read by `BmpReader` have to match the rows of the loaded image
+static int readerMatches(const Image *image, const char *path) {
+    BmpReader reader;
+    if (openBmp(&reader, path) != 0) return 0;
+
+    int same = reader.width == image->width && reader.height == image->height;
+    uint32_t bandRows = randomRange(1, image->height);
+    unsigned char *band = malloc((size_t)bandRows * reader.stride);
+    if (!band) same = 0;
+
+    for (uint32_t row = 0; same && row < reader.height; row += bandRows) {
+        uint32_t count = reader.height - row < bandRows ? reader.height - row : bandRows;
+        if (readBmpRows(&reader, row, count, band) != 0) { same = 0; break; }
+
+        for (uint32_t r = 0; same && r < count; ++r) {
+            const Pixel *expected = image->pixels + (size_t)(image->height - 1 - row - r) * image->width;
+            same = memcmp(band + (size_t)r * reader.stride, expected, image->width * sizeof(Pixel)) == 0;
+        }
+    }
+
+    free(band);
+    closeBmp(&reader);
+    return same;
+}
+
+
+static int testTransform(int iteration, const Image *image) {
+    Rect rect;
+    rect.x = randomRange(0, image->width - 1);
+    rect.y = randomRange(0, image->height - 1);
+    rect.w = randomRange(1, image->width - rect.x);
+    rect.h = randomRange(1, image->height - rect.y);
+
+    Image tested, reference;
+    CHECK(copyImage(&tested, image) && copyImage(&reference, image), "out of memory");
+
+    crop(&tested, &rect);
+    referenceCrop(&reference, &rect);
+    CHECK(sameImages(&tested, &reference), "crop differs from the reference");
+
+    CHECK(rotate(&tested) == 0 && referenceRotate(&reference) == 0, "rotate failed");
+    CHECK(sameImages(&tested, &reference), "rotate differs from the reference");
+
+    CHECK(saveBmp(&tested, outputPath) == 0 && referenceSaveBmp(&reference, referencePath) == 0, "save failed");
+    CHECK(sameFiles(outputPath, referencePath), "saveBmp differs from the reference");
+
+    destoryImage(&tested);
+    destoryImage(&reference);
+    return 0;
+}
+
+
+static int testStego(int iteration, const Image *image) {
+    int capacity = image->width * image->height * 3 / 5;
+    if (capacity == 0) return 0;
+
+    char message[STEGO_MESSAGE_MAX_LENGTH + 1];
+    int length = randomRange(1, capacity < 40 ? capacity : 40);
+    CHECK(writeMessage(messagePath, message, length), "can't write the message");
+
+    Image tested, reference;
+
+    // longer keys are allowed for encoding, extra lines are ignored
+    CHECK(writeKey(keyPath, 5 * length + randomRange(0, 10), image->width, image->height), "can't write the key");
+    CHECK(copyImage(&tested, image) && copyImage(&reference, image), "out of memory");
+    CHECK(encode(&tested, keyPath, messagePath) == 0, "encode failed");
+    CHECK(referenceEncode(&reference, keyPath, messagePath) == 0, "reference encode failed");
+    CHECK(sameImages(&tested, &reference), "encode differs from the reference");
+    destoryImage(&tested);
+    destoryImage(&reference);
+
+    CHECK(writeKey(keyPath, 5 * length, image->width, image->height), "can't write the key");
+    CHECK(copyImage(&tested, image) && copyImage(&reference, image), "out of memory");
+    CHECK(encode(&tested, keyPath, messagePath) == 0, "encode failed");
+    CHECK(referenceEncode(&reference, keyPath, messagePath) == 0, "reference encode failed");
+    CHECK(sameImages(&tested, &reference), "encode differs from the reference");
+
+    CHECK(decode(&tested, keyPath, outputPath) == 0, "decode failed");
+    CHECK(referenceDecode(&reference, keyPath, referencePath) == 0, "reference decode failed");
+    CHECK(sameFiles(outputPath, referencePath), "decode differs from the reference");
+
+    size_t size;
+    char *decoded = readFile(outputPath, &size);
+    CHECK(decoded, "can't read the decoded message");
+    int same = strcmp(decoded, message) == 0;
+    free(decoded);
+    CHECK(same, "decoded message differs from the encoded one");
+
+    // scan reads the same bits straight from the file
+    CHECK(saveBmp(&tested, scannedPath) == 0, "save failed");
+    Key key;
+    CHECK(loadKey(&key, keyPath) == 0, "loadKey failed");
+    ScanOptions options = { .threads = randomRange(1, 3) };
+    int error = captureScan(&key, &options);
+    destroyKey(&key);
+    CHECK(error == 0, "scanDirectory failed");
+
+    char expected[STEGO_MESSAGE_MAX_LENGTH + 128];
+    snprintf(expected, sizeof(expected), "%s\t%s\n", scannedPath, message);
+    char *scanned = readFile(capturePath, &size);
+    CHECK(scanned, "can't read the scan output");
+    same = strcmp(scanned, expected) == 0;
+    free(scanned);
+    CHECK(same, "scan differs from decode");
+
+    // compare the encoded image with the original one
+    Comparison fast, naive;
+    naiveComparison(image, &tested, &naive);
+    // every kernel supported here has to be checked, not only the one picked automatically
+    const CompareKernel kernels[] = { COMPARE_KERNEL_SCALAR, COMPARE_KERNEL_AVX2 };
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(*kernels); ++i) {
+        if (compareSetKernel(kernels[i]) != 0) continue;
+        error = compareBmp(&fast, inputPath, scannedPath, randomRange(1, 4));
+        compareSetKernel(COMPARE_KERNEL_AUTO);
+        CHECK(error == 0, "compareBmp failed");
+        CHECK(sameComparisons(&fast, &naive), "compareBmp differs from the naive comparison");
+    }
+
+    destoryImage(&tested);
+    destoryImage(&reference);
+    return 0;
+}
+
+
+/// Parallel analysis has to give exactly the same result as the single threaded one
+static int testAnalyze(int iteration) {
+    int tileSize = randomRange(1, 24);
+    Analysis single, parallel;
+    CHECK(analyzeBmp(&single, inputPath, tileSize, 1) == 0, "analyzeBmp failed");
+    CHECK(analyzeBmp(&parallel, inputPath, tileSize, randomRange(2, 4)) == 0, "analyzeBmp failed");
+
+    int same = single.tilesCount == parallel.tilesCount
+        && memcmp(single.image, parallel.image, sizeof(single.image)) == 0
+        && memcmp(single.tiles, parallel.tiles, single.tilesCount * sizeof(TileAnalysis)) == 0;
+    destroyAnalysis(&single);
+    destroyAnalysis(&parallel);
+    CHECK(same, "parallel analyzeBmp differs from the single threaded one");
+    return 0;
+}
+
+
+static int testIteration(int iteration, unsigned char *file, Pixel *pixels) {
+    // any width gives one of 4 possible paddings, wide rows also go through the vector kernels
+    uint32_t width = randomRange(1, 100);
+    uint32_t height = randomRange(1, 40);
+
+    size_t size = randomBmp(file, width, height, pixels);
+    CHECK(writeFile(inputPath, file, size), "can't write the image");
+
+    Image image;
+    CHECK(loadBmp(&image, inputPath) == 0, "loadBmp failed");
+    CHECK(image.width == width && image.height == height, "loadBmp read wrong size");
+    CHECK(memcmp(image.pixels, pixels, (size_t)width * height * sizeof(Pixel)) == 0, "loadBmp read wrong pixels");
+    CHECK(readerMatches(&image, inputPath), "BmpReader differs from loadBmp");
+
+    int failed = testTransform(iteration, &image)
+        || testStego(iteration, &image)
+        || testAnalyze(iteration);
+
+    destoryImage(&image);
+    return failed;
+}
+
+
+/// Runs the fuzzer entry point on valid images with corrupted headers and truncated data
+static void fuzzHeaders(int rounds, unsigned char *file, Pixel *pixels) {
+    for (int round = 0; round < rounds; ++round) {
+        size_t size = randomBmp(file, randomRange(1, 40), randomRange(1, 20), pixels);
+
+        int corruptions = randomRange(1, 4);
+        for (int i = 0; i < corruptions; ++i) {
+            size_t offset = randomRange(0, headerSize - 1);
+            // either a random byte or a large value to provoke overflows
+            file[offset] = rand() % 2 ? rand() : 0xFF;
+        }
+        if (rand() % 4 == 0) size = randomRange(0, size);
+
+        LLVMFuzzerTestOneInput(file, size);
+    }
+}
+
+
+int main(int argc, const char * argv[]) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 200;
+    unsigned seed = argc > 2 ? (unsigned)atoi(argv[2]) : 1;
+    srand(seed);
+
+    if (!mkdtemp(directory)) {
+        perror(directory);
+        return 1;
+    }
+    snprintf(scanDirectoryPath, sizeof(scanDirectoryPath), "%s/scan", directory);
+    snprintf(inputPath, sizeof(inputPath), "%s/input.bmp", directory);
+    snprintf(outputPath, sizeof(outputPath), "%s/output", directory);
+    snprintf(referencePath, sizeof(referencePath), "%s/reference", directory);
+    snprintf(keyPath, sizeof(keyPath), "%s/key.txt", directory);
+    snprintf(messagePath, sizeof(messagePath), "%s/message.txt", directory);
+    snprintf(capturePath, sizeof(capturePath), "%s/capture.txt", directory);
+    snprintf(scannedPath, sizeof(scannedPath), "%s/scan/encoded.bmp", directory);
+    mkdir(scanDirectoryPath, 0700);
+
+    // large enough for the biggest generated image
+    unsigned char *file = malloc(headerSize + 40 * rowStride(100));
+    Pixel *pixels = malloc(100 * 40 * sizeof(Pixel));
+    if (!file || !pixels) {
+        perror("equivalence");
+        return 1;
+    }
+
+    int failed = 0;
+    for (int i = 0; i < iterations && !failed; ++i)
+        failed = testIteration(i, file, pixels);
+
+    if (!failed) fuzzHeaders(iterations * 10, file, pixels);
+
+    const char *files[] = { inputPath, outputPath, referencePath, keyPath, messagePath, capturePath, scannedPath };
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); ++i)
+        unlink(files[i]);
+    rmdir(scanDirectoryPath);
+    rmdir(directory);
+    free(file);
+    free(pixels);
+
+    if (failed) {
+        fprintf(stderr, "equivalence: failed with seed %u\n", seed);
+        return 1;
+    }
+    printf("equivalence: %d iterations passed with seed %u\n", iterations, seed);
+    return 0;
+}
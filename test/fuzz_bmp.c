@@ -0,0 +1,98 @@
+#include "fuzz_bmp.h"
+#include "bmp.h"
+#include "compare.h"
+#include "analyze.h"
+#include "scan.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/// Loaders only accept file names, so every input is written to a file first, alone in its directory to be scanned
+static char directory[] = "/tmp/fuzz-bmp-XXXXXX";
+static char path[sizeof(directory) + 16];
+static int fd = -1;
+/// `scanDirectory` prints the messages, they aren't checked, so `stdout` is redirected here
+static int devNull = -1;
+
+/// Fixed key for `scanDirectory`, two characters in the top left pixel, which every valid image has
+static KeyBit keyBits[] = {
+    {0, 0, 0}, {0, 0, 1}, {0, 0, 2}, {0, 0, 1}, {0, 0, 0},
+    {0, 0, 2}, {0, 0, 0}, {0, 0, 1}, {0, 0, 2}, {0, 0, 1}
+};
+static const Key key = { sizeof(keyBits) / sizeof(*keyBits), keyBits };
+
+
+/// Removes the temporary files, registered with `atexit` since libFuzzer never returns control to the caller
+static void removeTemporaryFiles(void) {
+    close(fd);
+    close(devNull);
+    unlink(path);
+    rmdir(directory);
+}
+
+
+/// Creates the temporary directory with the input file in it, only once
+static int setUp(void) {
+    if (fd >= 0) return 1;
+    if (!mkdtemp(directory)) return 0;
+    snprintf(path, sizeof(path), "%s/input.bmp", directory);
+
+    fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+    devNull = open("/dev/null", O_WRONLY);
+    atexit(removeTemporaryFiles);
+    return fd >= 0 && devNull >= 0;
+}
+
+
+/// Runs `scanDirectory` on the input file with `stdout` discarded, `stderr` is kept for sanitizer reports
+static void scanInput(void) {
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    if (saved < 0) return;
+
+    dup2(devNull, STDOUT_FILENO);
+    ScanOptions options = { .threads = 1 };
+    scanDirectory(directory, &key, &options);
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+}
+
+
+/**
+ libFuzzer entry point: feeds arbitrary bytes as a bmp file to all the loaders
+
+ Malformed files have to be rejected with an error code, crashes and sanitizer reports are failures.
+ Also called by the `equivalence` test on randomly corrupted headers, so it works without libFuzzer too.
+ */
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    if (!setUp()) return 0;
+    if (ftruncate(fd, 0) != 0 || pwrite(fd, data, size, 0) != (ssize_t)size) return 0;
+
+    Image image;
+    if (loadBmp(&image, path) == 0) destoryImage(&image);
+
+    BmpReader reader;
+    int opened = openBmp(&reader, path) == 0;
+    if (opened) {
+        unsigned char *row = malloc(reader.stride);
+        for (uint32_t y = 0; row && y < reader.height; ++y)
+            if (readBmpRows(&reader, y, 1, row) != 0) break;
+        free(row);
+        closeBmp(&reader);
+    }
+
+    Comparison comparison;
+    compareBmp(&comparison, path, path, 1);
+
+    Analysis analysis;
+    if (analyzeBmp(&analysis, path, ANALYZE_DEFAULT_TILE_SIZE, 1) == 0) destroyAnalysis(&analysis);
+
+    // scan opens files with `openBmp` too, headers it rejects would only be reported to `stderr`
+    if (opened) scanInput();
+
+    return 0;
+}
+
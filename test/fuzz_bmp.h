@@ -0,0 +1,10 @@
+#ifndef fuzz_bmp_h
+#define fuzz_bmp_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// libFuzzer entry point for the bmp loaders
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+#endif /* fuzz_bmp_h */
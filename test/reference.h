@@ -0,0 +1,19 @@
+#ifndef reference_h
+#define reference_h
+
+#include "bmp.h"
+
+// Frozen copies of the original `crop`, `rotate`, `saveBmp`, `encode` and `decode`.
+// Optimized versions in `src` have to produce exactly the same results, these should never be changed.
+
+void referenceCrop(Image *image, Rect *rect);
+
+int referenceRotate(Image *image);
+
+int referenceSaveBmp(const Image *image, const char *filename);
+
+int referenceEncode(Image *image, const char *keyFile, const char *messageFile);
+
+int referenceDecode(const Image *image, const char *keyFile, const char *filename);
+
+#endif /* reference_h */